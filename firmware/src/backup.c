@@ -0,0 +1,208 @@
+#include <string.h>
+
+#include <bsp/board_api.h>
+#include <hardware/flash.h>
+#include <pico/stdlib.h>
+#include <tusb.h>
+
+#include "backup.h"
+#include "counter.h"
+#include "crc32.h"
+#include "hid.h"
+#include "storage.h"
+
+typedef enum { BACKUP_IDLE, BACKUP_SENDING, BACKUP_RECEIVING } backup_state_t;
+
+static backup_state_t state = BACKUP_IDLE;
+static backup_header_t request;
+static uint32_t request_len = 0; // header bytes received
+static uint32_t armed_until_ms = 0;
+static bool armed = false;
+
+// range being streamed
+static uint32_t xfer_offset = 0;
+static uint32_t xfer_left = 0;
+
+// sector being restored
+static uint8_t sector_buf[FLASH_SECTOR_SIZE];
+static uint32_t sector_len = 0;
+
+// ---------- Helpers ----------
+
+static const uint8_t *store_ptr(uint32_t offset) {
+  return (const uint8_t *)(XIP_BASE + FLASH_TARGET_OFFSET + offset);
+}
+
+static void backup_reply(uint8_t status, uint32_t offset, uint32_t length,
+                         uint32_t crc) {
+  backup_header_t reply = {
+      .magic = BACKUP_MAGIC,
+      .op = request.op,
+      .status = status,
+      .offset = offset,
+      .length = length,
+      .crc = crc,
+  };
+
+  tud_vendor_write(&reply, sizeof(reply));
+  tud_vendor_write_flush();
+}
+
+static bool backup_armed(void) {
+  if (armed && (int32_t)(board_millis() - armed_until_ms) >= 0)
+    armed = false;
+  return armed;
+}
+
+// Drop whatever the host queued after a bad request
+static void backup_drain(void) {
+  uint8_t buf[64];
+  while (tud_vendor_read(buf, sizeof(buf)) > 0)
+    ;
+  request_len = 0;
+}
+
+// Restore one received sector
+static void backup_write_sector(void) {
+  uint32_t offset = FLASH_TARGET_OFFSET + request.offset;
+
+  if (crc32_update(0, sector_buf, sector_len) != request.crc) {
+    backup_reply(BACKUP_STATUS_BAD_CRC, request.offset, 0, 0);
+    return;
+  }
+
+  // counters are merged, a restore never moves them backwards
+  uint32_t counter_end =
+      FLASH_COUNTER_OFFSET + FLASH_COUNTER_SECTORS * FLASH_SECTOR_SIZE;
+  if (offset >= FLASH_COUNTER_OFFSET && offset < counter_end) {
+    backup_reply(counter_restore(offset, sector_buf) ? BACKUP_STATUS_MERGED
+                                                     : BACKUP_STATUS_BAD_RANGE,
+                 request.offset + FLASH_SECTOR_SIZE, 0, 0);
+    return;
+  }
+
+  // playback reads macros from flash, stop it before rewriting
+  hid_play_stream(NULL, 0);
+  flash_erase_sector(offset);
+  for (uint32_t page = 0; page < FLASH_SECTOR_SIZE; page += FLASH_PAGE_SIZE)
+    flash_program_page(offset + page, sector_buf + page);
+
+  // read back what was programmed
+  uint32_t crc = crc32_update(0, store_ptr(request.offset), FLASH_SECTOR_SIZE);
+  backup_reply(crc == request.crc ? BACKUP_STATUS_OK : BACKUP_STATUS_BAD_CRC,
+               request.offset + FLASH_SECTOR_SIZE, 0, crc);
+}
+
+static void backup_handle_request(void) {
+  if (request.magic != BACKUP_MAGIC) {
+    backup_drain();
+    backup_reply(BACKUP_STATUS_BAD_REQUEST, 0, 0, 0);
+    return;
+  }
+
+  // only the store size is served without a user present
+  if (request.op != BACKUP_OP_INFO && !backup_armed()) {
+    backup_reply(BACKUP_STATUS_NOT_ARMED, request.offset, 0, 0);
+    return;
+  }
+
+  if (request.offset > FLASH_STORE_SIZE ||
+      request.length > FLASH_STORE_SIZE - request.offset) {
+    backup_reply(BACKUP_STATUS_BAD_RANGE, request.offset, 0, 0);
+    return;
+  }
+
+  switch (request.op) {
+  case BACKUP_OP_INFO:
+    // the crc is a digest of the keys, keep it behind the button too
+    backup_reply(BACKUP_STATUS_OK, 0, FLASH_STORE_SIZE,
+                 backup_armed() ? crc32_update(0, store_ptr(0),
+                                               FLASH_STORE_SIZE)
+                                : 0);
+    break;
+
+  case BACKUP_OP_CRC:
+    backup_reply(BACKUP_STATUS_OK, request.offset, request.length,
+                 crc32_update(0, store_ptr(request.offset), request.length));
+    break;
+
+  case BACKUP_OP_READ:
+    backup_reply(BACKUP_STATUS_OK, request.offset, request.length,
+                 crc32_update(0, store_ptr(request.offset), request.length));
+    xfer_offset = request.offset;
+    xfer_left = request.length;
+    state = BACKUP_SENDING;
+    break;
+
+  case BACKUP_OP_WRITE:
+    if (request.offset % FLASH_SECTOR_SIZE ||
+        request.length != FLASH_SECTOR_SIZE) {
+      backup_reply(BACKUP_STATUS_BAD_RANGE, request.offset, 0, 0);
+      break;
+    }
+    // ack, the host sends the sector only now
+    backup_reply(BACKUP_STATUS_OK, request.offset, request.length, 0);
+    sector_len = 0;
+    state = BACKUP_RECEIVING;
+    break;
+
+  default:
+    backup_drain();
+    backup_reply(BACKUP_STATUS_BAD_REQUEST, 0, 0, 0);
+    break;
+  }
+}
+
+// ---------- Core functions ----------
+
+// Allow backup and restore for a while, called on a BOOTSEL press
+void backup_arm(void) {
+  armed_until_ms = board_millis() + BACKUP_ARM_MS;
+  armed = true;
+}
+
+// Serve the vendor interface, must be called regularly
+void backup_task(void) {
+  if (!tud_vendor_mounted()) {
+    state = BACKUP_IDLE;
+    request_len = 0;
+    return;
+  }
+
+  switch (state) {
+  case BACKUP_IDLE:
+    request_len += tud_vendor_read((uint8_t *)&request + request_len,
+                                   sizeof(request) - request_len);
+    if (request_len == sizeof(request)) {
+      request_len = 0;
+      backup_handle_request();
+    }
+    break;
+
+  case BACKUP_SENDING: {
+    // fill the FIFO straight from flash
+    uint32_t len = tud_vendor_write_available();
+    if (len > xfer_left)
+      len = xfer_left;
+
+    len = tud_vendor_write(store_ptr(xfer_offset), len);
+    xfer_offset += len;
+    xfer_left -= len;
+
+    if (xfer_left == 0) {
+      tud_vendor_write_flush();
+      state = BACKUP_IDLE;
+    }
+    break;
+  }
+
+  case BACKUP_RECEIVING:
+    sector_len += tud_vendor_read(sector_buf + sector_len,
+                                  FLASH_SECTOR_SIZE - sector_len);
+    if (sector_len == FLASH_SECTOR_SIZE) {
+      state = BACKUP_IDLE;
+      backup_write_sector();
+    }
+    break;
+  }
+}
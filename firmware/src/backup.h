@@ -0,0 +1,45 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+
+#include <stdint.h>
+
+// Key store backup and restore over the vendor bulk interface.
+// Every request and reply starts with a backup_header_t (little endian).
+// READ replies are followed by the data. WRITE is acked first, the host
+// sends the sector only after that ack, then gets a second reply.
+// Everything but INFO needs the interface armed by a BOOTSEL press, an
+// unarmed INFO only reports the store size.
+
+#define BACKUP_MAGIC 0x50424B53 // "SKBP"
+#define BACKUP_ARM_MS 30000     // armed time after a BOOTSEL press
+
+typedef enum {
+  BACKUP_OP_INFO = 0, // reply: length = store size, crc of the store if armed
+  BACKUP_OP_CRC,      // reply: crc of offset..offset+length
+  BACKUP_OP_READ,     // reply: crc of the range, then the data
+  BACKUP_OP_WRITE,    // one sector with its crc, reply: next offset
+} backup_op_t;
+
+typedef enum {
+  BACKUP_STATUS_OK = 0,
+  BACKUP_STATUS_BAD_REQUEST,
+  BACKUP_STATUS_BAD_RANGE,
+  BACKUP_STATUS_BAD_CRC,
+  BACKUP_STATUS_NOT_ARMED,
+  BACKUP_STATUS_MERGED, // counter sector: counters only moved forward
+} backup_status_t;
+
+typedef struct {
+  uint32_t magic;
+  uint8_t op;
+  uint8_t status;
+  uint8_t reserved[2];
+  uint32_t offset; // from the start of the key store
+  uint32_t length;
+  uint32_t crc;
+} backup_header_t;
+
+void backup_arm(void);
+void backup_task(void);
+
+#endif // BACKUP_H
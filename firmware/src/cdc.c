@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,27 +9,63 @@
 #include <tusb.h>
 
 #include "debug.h"
+#include "macro.h"
+#include "stats.h"
 #include "storage.h"
 #include "usb_descriptors.h"
 
 #define BOOTSEL_MASK (1u << 23)
 
-typedef enum { CMD_UNKNOWN, CMD_MKEY, CMD_SKEY } CommandType;
+typedef enum {
+  CMD_UNKNOWN,
+  CMD_MKEY,
+  CMD_SKEY,
+  CMD_MBEG,
+  CMD_MDAT,
+  CMD_MEND,
+  CMD_MRUN,
+  CMD_LIST
+} CommandType;
 
 CommandType parse_command(const char *cmd) {
   if (strcmp(cmd, "SKEY") == 0)
     return CMD_SKEY;
+  if (strcmp(cmd, "MBEG") == 0)
+    return CMD_MBEG;
+  if (strcmp(cmd, "MDAT") == 0)
+    return CMD_MDAT;
+  if (strcmp(cmd, "MEND") == 0)
+    return CMD_MEND;
+  if (strcmp(cmd, "MRUN") == 0)
+    return CMD_MRUN;
+  if (strcmp(cmd, "LIST") == 0)
+    return CMD_LIST;
 
   return CMD_UNKNOWN;
 }
 
+// decode hex digits in place, stop at the first non hex char
+size_t parse_hex(uint8_t *str) {
+  uint8_t *out = str; // never ahead of str
+  size_t len = 0;
+
+  while (isxdigit(str[0]) && isxdigit(str[1])) {
+    char byte[3] = {str[0], str[1], 0};
+    out[len++] = (uint8_t)strtoul(byte, NULL, 16);
+    str += 2;
+  }
+
+  return len;
+}
+
 // callback when data is received on a CDC interface
 void tud_cdc_rx_cb(uint8_t itf) {
-  // allocate buffer for the data in the stack
-  uint8_t buf[CFG_TUD_CDC_RX_BUFSIZE];
-  uint32_t count = tud_cdc_n_read(itf, buf, sizeof(buf));
+  // allocate buffer for the data in the stack | plus 1 for the null
+  uint8_t buf[CFG_TUD_CDC_RX_BUFSIZE + 1];
+  uint32_t count = tud_cdc_n_read(itf, buf, sizeof(buf) - 1);
 
   buf[count] = 0; // null-terminate the string
+  stats.cdc_rx_bytes += count;
 
   // command
   char command[5] = {0}; // 4 chars + null
@@ -48,6 +85,8 @@ void tud_cdc_rx_cb(uint8_t itf) {
 
   // handle command
   CommandType cmd = parse_command(command);
+  if (cmd != CMD_UNKNOWN)
+    stats.cdc_commands++;
 
   switch (cmd) {
   case CMD_SKEY:
@@ -56,6 +95,46 @@ void tud_cdc_rx_cb(uint8_t itf) {
       printf("Set SKEY\n");
     };
     break;
+
+  case CMD_MBEG:
+    if (arg && macro_begin((uint8_t)atoi((char *)arg)))
+      printf("Begin macro\n");
+    break;
+
+  case CMD_MDAT: {
+    size_t len = arg ? parse_hex(arg) : 0;
+    if (len && macro_append(arg, len))
+      printf("OK\n");
+    else
+      printf("Macro data rejected\n");
+    break;
+  }
+
+  case CMD_MEND:
+    if (macro_commit())
+      printf("Stored macro\n");
+    else
+      printf("Invalid macro\n");
+    break;
+
+  case CMD_MRUN:
+    if (arg && macro_play((uint8_t)atoi((char *)arg)))
+      printf("Playing macro\n");
+    break;
+
+  case CMD_LIST:
+    // populated slots, never their content
+    printf("Slots:");
+    if (flash_read_string(MKEY_BLOCK)[0])
+      printf(" MKEY");
+    if (flash_read_string(SKEY_BLOCK)[0])
+      printf(" SKEY");
+    for (uint8_t i = 0; i < MACRO_MAX; i++) {
+      if (macro_stored(i))
+        printf(" M%u", i);
+    }
+    printf("\n");
+    break;
   }
 }
 
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <hardware/flash.h>
+#include <pico/stdlib.h>
+
+#include "counter.h"
+#include "storage.h"
+
+// Each counter owns two flash sectors, only one of them is active.
+// The first page of the active sector holds a header with the base value,
+// the remaining pages are a tally: every increment clears one more bit
+// (1 -> 0) so it costs a single page program and never an erase.
+// When the tally is full the next value is written as the base of the
+// other sector, then the old sector is erased. At boot the valid header
+// with the highest base wins, so a crash at any step loses nothing.
+
+#define COUNTER_MAGIC 0x544E4353 // "SCNT"
+#define COUNTER_TALLY_BYTES (FLASH_SECTOR_SIZE - FLASH_PAGE_SIZE)
+#define COUNTER_TALLY_BITS (COUNTER_TALLY_BYTES * 8)
+
+_Static_assert(COUNTER_MAX * 2 <= FLASH_COUNTER_SECTORS,
+               "not enough flash sectors for counters");
+
+typedef struct {
+  uint32_t magic;
+  uint32_t base;
+  uint32_t base_inv; // ~base, detects a half programmed header
+} counter_header_t;
+
+typedef struct {
+  uint8_t sector; // active sector (0 or 1)
+  uint32_t base;  // value stored in the active header
+  uint32_t used;  // bits cleared in the active tally
+} counter_state_t;
+
+static counter_state_t counters[COUNTER_MAX];
+
+// ---------- Helpers ----------
+
+// Flash offset of one of the two sectors of a counter
+static uint32_t counter_sector_offset(counter_id_t id, uint8_t sector) {
+  return FLASH_COUNTER_OFFSET + (id * 2 + sector) * FLASH_SECTOR_SIZE;
+}
+
+// Sector contents in XIP flash
+static const uint8_t *counter_sector_ptr(counter_id_t id, uint8_t sector) {
+  return (const uint8_t *)(XIP_BASE + counter_sector_offset(id, sector));
+}
+
+// Read header, return false if it is not valid
+static bool counter_read_header(const uint8_t *sector, uint32_t *base) {
+  const counter_header_t *hdr = (const counter_header_t *)sector;
+  if (hdr->magic != COUNTER_MAGIC || hdr->base != ~hdr->base_inv)
+    return false;
+  *base = hdr->base;
+  return true;
+}
+
+// Erase a sector and write a fresh header
+static void counter_write_header(uint32_t offset, uint32_t base) {
+  uint8_t page_buf[FLASH_PAGE_SIZE];
+  counter_header_t hdr = {COUNTER_MAGIC, base, ~base};
+
+  memset(page_buf, 0xFF, sizeof(page_buf));
+  memcpy(page_buf, &hdr, sizeof(hdr));
+
+  flash_erase_sector(offset);
+  flash_program_page(offset, page_buf);
+}
+
+// Count cleared bits, they are always cleared in order
+static uint32_t counter_scan_tally(const uint8_t *sector) {
+  const uint8_t *tally = sector + FLASH_PAGE_SIZE;
+  uint32_t used = 0;
+
+  for (uint32_t i = 0; i < COUNTER_TALLY_BYTES; i++) {
+    if (tally[i] != 0x00) {
+      used += 8 - __builtin_popcount(tally[i]);
+      break;
+    }
+    used += 8;
+  }
+
+  return used;
+}
+
+// Move to the other sector, starting from base
+static void counter_rollover(counter_id_t id, uint32_t base) {
+  counter_state_t *c = &counters[id];
+  uint8_t next = c->sector ^ 1;
+
+  // new header first, old sector stays valid until it is written
+  counter_write_header(counter_sector_offset(id, next), base);
+  flash_erase_sector(counter_sector_offset(id, c->sector));
+
+  c->sector = next;
+  c->base = base;
+  c->used = 0;
+}
+
+// ---------- Core functions ----------
+
+// Recover all counters from flash, must run once at boot
+void counter_init(void) {
+  for (counter_id_t id = 0; id < COUNTER_MAX; id++) {
+    counter_state_t *c = &counters[id];
+    uint32_t base[2];
+    bool valid[2];
+
+    for (uint8_t s = 0; s < 2; s++)
+      valid[s] = counter_read_header(counter_sector_ptr(id, s), &base[s]);
+
+    if (!valid[0] && !valid[1]) {
+      // blank flash: start from zero
+      counter_write_header(counter_sector_offset(id, 0), 0);
+      c->sector = 0;
+      c->base = 0;
+      c->used = 0;
+      continue;
+    }
+
+    if (valid[0] && valid[1]) {
+      // interrupted rollover: finish it by dropping the older sector
+      c->sector = base[1] > base[0] ? 1 : 0;
+      flash_erase_sector(counter_sector_offset(id, c->sector ^ 1));
+    } else {
+      c->sector = valid[1] ? 1 : 0;
+    }
+
+    c->base = base[c->sector];
+    c->used = counter_scan_tally(counter_sector_ptr(id, c->sector));
+  }
+}
+
+// Current value of a counter
+uint32_t counter_read(counter_id_t id) {
+  if (id >= COUNTER_MAX)
+    return 0;
+  return counters[id].base + counters[id].used;
+}
+
+// Increment a counter and optionally return the new value
+bool counter_increment(counter_id_t id, uint32_t *value) {
+  if (id >= COUNTER_MAX)
+    return false;
+
+  counter_state_t *c = &counters[id];
+  if (c->base + c->used == UINT32_MAX)
+    return false; // exhausted, never wrap
+
+  if (c->used == COUNTER_TALLY_BITS) {
+    counter_rollover(id, c->base + c->used + 1);
+  } else {
+    // clear the next bit, every other bit of the page is left at 1
+    uint32_t offset = counter_sector_offset(id, c->sector) + FLASH_PAGE_SIZE +
+                      c->used / 8;
+    uint32_t page_offset = offset & ~(FLASH_PAGE_SIZE - 1);
+    uint8_t page_buf[FLASH_PAGE_SIZE];
+
+    memset(page_buf, 0xFF, sizeof(page_buf));
+    page_buf[offset % FLASH_PAGE_SIZE] = (uint8_t)(0xFF << (c->used % 8 + 1));
+    flash_program_page(page_offset, page_buf);
+    c->used++;
+  }
+
+  if (value)
+    *value = counter_read(id);
+  return true;
+}
+
+// Merge a counter sector image (e.g. from a backup) at flash offset:
+// the counter moves up to the value in the image, never down
+bool counter_restore(uint32_t offset, const uint8_t *sector) {
+  if (offset < FLASH_COUNTER_OFFSET || offset % FLASH_SECTOR_SIZE)
+    return false;
+
+  counter_id_t id = (offset - FLASH_COUNTER_OFFSET) / FLASH_SECTOR_SIZE / 2;
+  if (id >= COUNTER_MAX)
+    return id < FLASH_COUNTER_SECTORS / 2; // spare sectors stay unused
+
+  uint32_t base;
+  if (!counter_read_header(sector, &base))
+    return true; // blank or stale half of the pair
+
+  uint32_t value = base + counter_scan_tally(sector);
+  if (value < base)
+    value = UINT32_MAX;
+  if (value > counter_read(id))
+    counter_rollover(id, value);
+  return true;
+}
@@ -0,0 +1,15 @@
+#ifndef COUNTER_H
+#define COUNTER_H
+
+typedef enum {
+  U2F_COUNTER = 0,
+  HOTP_COUNTER,
+  COUNTER_MAX
+} counter_id_t;
+
+void counter_init(void);
+uint32_t counter_read(counter_id_t id);
+bool counter_increment(counter_id_t id, uint32_t *value);
+bool counter_restore(uint32_t offset, const uint8_t *sector);
+
+#endif // COUNTER_H
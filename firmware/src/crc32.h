@@ -0,0 +1,10 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3), start with crc = 0, shared with the host tools
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif // CRC32_H
@@ -2,6 +2,8 @@
 #include <pico/stdio.h>
 #include <tusb.h>
 
+#include "hid.h"
+#include "stats.h"
 #include "usb_descriptors.h"
 
 // hid queue ~2.1 KB
@@ -23,14 +25,22 @@ const char *typing_ptr = NULL; // currently typing string
 volatile bool typing_active = false;
 volatile bool hid_callback = false;
 
+// playing a report stream
+const uint8_t *stream_ptr = NULL; // next report of the stream
+uint16_t stream_left = 0;         // reports left to play
+uint32_t stream_pause_until = 0;  // end of the current pause
+bool stream_paused = false;
+
 // key mapping
 uint8_t const hid_ascii_to_keycode[128][2] = {HID_ASCII_TO_KEYCODE};
 
 // hid queue
 bool hid_queue_push(uint8_t report_id, const uint8_t *buf, uint8_t len) {
   uint8_t next = (hid_head + 1) % HID_QUEUE_SIZE;
-  if (next == hid_tail)
+  if (next == hid_tail) {
+    stats.hid_queue_drops++;
     return false; // queue full
+  }
 
   if (len > HID_REPORT_MAX)
     len = HID_REPORT_MAX;
@@ -38,6 +48,9 @@ bool hid_queue_push(uint8_t report_id, const uint8_t *buf, uint8_t len) {
   hid_queue[hid_head].len = len;
   memcpy(hid_queue[hid_head].data, buf, len);
   hid_head = next;
+
+  stats_max(&stats.hid_queue_depth_max,
+            (hid_head - hid_tail + HID_QUEUE_SIZE) % HID_QUEUE_SIZE);
   return true;
 }
 
@@ -62,6 +75,18 @@ void hid_type_string(const char *str) {
   // Safe replacement: discard remaining characters
   typing_ptr = str;
   typing_active = true;
+  stream_left = 0;
+}
+
+// playing a precompiled report stream
+void hid_play_stream(const uint8_t *reports, uint16_t count) {
+  // Safe replacement: discard remaining reports, release held modifiers
+  if (stream_left)
+    hid_queue_push_keyboard_release();
+  stream_ptr = reports;
+  stream_left = count;
+  stream_paused = false;
+  typing_active = false;
 }
 
 void hid_type_push_next_char(void) {
@@ -87,17 +112,48 @@ void hid_type_push_next_char(void) {
   }
 }
 
+void hid_stream_push_next(void) {
+  while (stream_left && ((hid_head + 1) % HID_QUEUE_SIZE != hid_tail)) {
+    if (stream_ptr[1] == HID_STREAM_PAUSE) {
+      // pause starts once every report before it was sent
+      if (!stream_paused) {
+        if (hid_tail != hid_head)
+          return;
+        stream_pause_until =
+            board_millis() + (stream_ptr[2] | (stream_ptr[3] << 8));
+        stream_paused = true;
+      }
+
+      if ((int32_t)(board_millis() - stream_pause_until) < 0)
+        return;
+      stream_paused = false;
+    } else {
+      // precompiled report: copy as is
+      hid_queue_push(REPORT_ID_KEYBOARD, stream_ptr, HID_STREAM_REPORT_LEN);
+    }
+
+    stream_ptr += HID_STREAM_REPORT_LEN;
+    stream_left--;
+  }
+}
+
 void hid_send_from_queue() {
   if (hid_tail != hid_head) {
     hid_report_t *rpt = &hid_queue[hid_tail];
-    tud_hid_report(rpt->report_id, rpt->data, rpt->len);
+    if (tud_hid_report(rpt->report_id, rpt->data, rpt->len))
+      stats.hid_reports_sent++;
     hid_callback = true;
   }
 
   if (hid_tail == hid_head && hid_callback) {
     hid_callback = false;
     uint8_t report[8] = {0}; // all zeros: no keys, no modifier
-    tud_hid_report(REPORT_ID_KEYBOARD, report, sizeof(report));
+
+    // a paused stream keeps its held modifiers down
+    if (stream_left && stream_paused)
+      report[0] = stream_ptr[0];
+    if (tud_hid_report(REPORT_ID_KEYBOARD, report, sizeof(report)))
+      stats.hid_reports_sent++;
   }
 }
 
@@ -129,6 +185,9 @@ void hid_task(void) {
   // Push first character of typing string if queue has space
   hid_type_push_next_char();
 
+  // Fill queue from the report stream
+  hid_stream_push_next();
+
   // Send next report from queue
   hid_send_from_queue();
 }
@@ -151,6 +210,9 @@ void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report,
   // Push first character of typing string if queue has space
   hid_type_push_next_char();
 
+  // Fill queue from the report stream
+  hid_stream_push_next();
+
   // Send next report from queue
   hid_send_from_queue();
 }
@@ -159,14 +221,17 @@ void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report,
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id,
                                hid_report_type_t report_type, uint8_t *buffer,
                                uint16_t reqlen) {
-  // TODO not Implemented
   (void)instance;
-  (void)report_id;
-  (void)report_type;
-  (void)buffer;
-  (void)reqlen;
 
-  return 0;
+  // only the stats feature report is readable
+  if (report_id != REPORT_ID_STATS || report_type != HID_REPORT_TYPE_FEATURE)
+    return 0;
+
+  stats.uptime_ms = board_millis();
+
+  uint16_t len = sizeof(stats) < reqlen ? sizeof(stats) : reqlen;
+  memcpy(buffer, &stats, len);
+  return len;
 }
 
 // Invoked when received SET_REPORT control request
@@ -175,6 +240,12 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id,
                            uint16_t bufsize) {
   (void)instance;
 
+  // writing the stats feature report resets the counters
+  if (report_id == REPORT_ID_STATS && report_type == HID_REPORT_TYPE_FEATURE) {
+    stats_reset();
+    return;
+  }
+
   printf("Receive HID Report");
 
   // echo back anything we received from host
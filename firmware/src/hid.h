@@ -6,5 +6,15 @@ bool hid_queue_push(uint8_t report_id, const uint8_t *buf, uint8_t len);
 bool hid_queue_push_keyboard(uint8_t modifier, uint8_t keycodes[6]);
 void hid_queue_push_keyboard_release(void);
 void hid_type_string(const char *str);
+void hid_play_stream(const uint8_t *reports, uint16_t count);
+
+// A report stream is a packed array of 8-byte keyboard reports.
+// Entries with HID_STREAM_PAUSE in the reserved byte are not sent,
+// bytes 2-3 hold a pause in ms (little endian) instead and byte 0 the
+// modifiers kept down during it.
+#define HID_STREAM_REPORT_LEN 8
+#define HID_STREAM_PAUSE 0xFF
+
+extern uint8_t const hid_ascii_to_keycode[128][2];
 
 #endif // HID_H
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <hardware/flash.h>
+#include <pico/stdlib.h>
+
+#include "hid.h"
+#include "macro.h"
+#include "storage.h"
+
+// A stored macro is one flash sector: a header followed by the compiled
+// report stream, so playback reads reports straight from XIP flash.
+// Slot references are resolved when the macro is stored.
+
+#define MACRO_MAGIC 0x4F52434D // "MCRO"
+#define MACRO_REPORTS_MAX                                                      \
+  ((FLASH_SECTOR_SIZE - sizeof(macro_header_t)) / HID_STREAM_REPORT_LEN)
+
+_Static_assert(MACRO_MAX <= FLASH_MACRO_SECTORS,
+               "not enough flash sectors for macros");
+
+typedef struct {
+  uint32_t magic;
+  uint16_t count;     // reports in the stream
+  uint16_t count_inv; // ~count, detects a half programmed header
+} macro_header_t;
+
+// bytecode being staged
+static uint8_t macro_code[MACRO_CODE_MAX];
+static size_t macro_code_len = 0;
+static int macro_index = -1;
+
+// sector image being compiled
+static uint8_t macro_image[FLASH_SECTOR_SIZE];
+static uint16_t macro_count = 0;
+static uint8_t macro_held = 0; // modifiers held by MACRO_OP_HOLD
+
+// ---------- Helpers ----------
+
+static uint32_t macro_offset(uint8_t index) {
+  return FLASH_MACRO_OFFSET + index * FLASH_SECTOR_SIZE;
+}
+
+// Return header of a stored macro or NULL
+static const macro_header_t *macro_header(uint8_t index) {
+  if (index >= MACRO_MAX)
+    return NULL;
+
+  const macro_header_t *hdr =
+      (const macro_header_t *)(XIP_BASE + macro_offset(index));
+  if (hdr->magic != MACRO_MAGIC || hdr->count != (uint16_t)~hdr->count_inv)
+    return NULL;
+  return hdr;
+}
+
+// Append one report to the image
+static bool macro_emit(uint8_t modifier, uint8_t reserved,
+                       const uint8_t *keycodes, uint8_t count) {
+  if (macro_count >= MACRO_REPORTS_MAX)
+    return false; // image full
+
+  uint8_t *report = macro_image + sizeof(macro_header_t) +
+                    macro_count * HID_STREAM_REPORT_LEN;
+  memset(report, 0, HID_STREAM_REPORT_LEN);
+  report[0] = modifier;
+  report[1] = reserved;
+  if (count)
+    memcpy(&report[2], keycodes, count);
+
+  macro_count++;
+  return true;
+}
+
+// Type text: press + release per character
+static bool macro_emit_text(const char *str, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = (uint8_t)(str[i] & 0x7F);
+    uint8_t modifier = macro_held;
+
+    if (hid_ascii_to_keycode[c][0])
+      modifier |= KEYBOARD_MODIFIER_LEFTSHIFT;
+
+    if (!macro_emit(modifier, 0, &hid_ascii_to_keycode[c][1], 1) ||
+        !macro_emit(macro_held, 0, NULL, 0))
+      return false;
+  }
+  return true;
+}
+
+// Compile staged bytecode into macro_image
+static bool macro_compile(void) {
+  size_t pc = 0;
+
+  macro_count = 0;
+  macro_held = 0;
+  memset(macro_image, 0xFF, sizeof(macro_image));
+
+  while (pc < macro_code_len && macro_code[pc] != MACRO_OP_END) {
+    const uint8_t *arg = &macro_code[pc + 1];
+    size_t left = macro_code_len - pc - 1; // bytes after opcode
+    size_t size;                           // bytes of arguments
+    bool ok;
+
+    switch (macro_code[pc]) {
+    case MACRO_OP_TEXT:
+      if (left < 1 || left < 1u + arg[0])
+        return false;
+      size = 1 + arg[0];
+      ok = macro_emit_text((const char *)&arg[1], arg[0]);
+      break;
+
+    case MACRO_OP_CHORD:
+      if (left < 2 || arg[1] > 6 || left < 2u + arg[1])
+        return false;
+      size = 2 + arg[1];
+      ok = macro_emit(macro_held | arg[0], 0, &arg[2], arg[1]) &&
+           macro_emit(macro_held, 0, NULL, 0);
+      break;
+
+    case MACRO_OP_HOLD:
+      if (left < 1)
+        return false;
+      size = 1;
+      macro_held |= arg[0];
+      ok = macro_emit(macro_held, 0, NULL, 0);
+      break;
+
+    case MACRO_OP_RELEASE:
+      if (left < 1)
+        return false;
+      size = 1;
+      macro_held &= ~arg[0];
+      ok = macro_emit(macro_held, 0, NULL, 0);
+      break;
+
+    case MACRO_OP_DELAY: {
+      if (left < 2)
+        return false;
+      size = 2;
+      uint8_t ms[2] = {arg[0], arg[1]};
+      ok = macro_emit(macro_held, HID_STREAM_PAUSE, ms, sizeof(ms));
+      break;
+    }
+
+    case MACRO_OP_SLOT: {
+      if (left < 1 || arg[0] >= BLOCK_MAX)
+        return false;
+      size = 1;
+      const char *str = flash_read_string((flash_block_t)arg[0]);
+      ok = macro_emit_text(str, strnlen(str, BLOCK_SIZE));
+      break;
+    }
+
+    default:
+      return false; // unknown opcode
+    }
+
+    if (!ok)
+      return false;
+    pc += 1 + size;
+  }
+
+  // never leave modifiers pressed
+  if (macro_held)
+    return macro_emit(0, 0, NULL, 0);
+  return true;
+}
+
+// ---------- Core functions ----------
+
+// Start staging bytecode for a macro
+bool macro_begin(uint8_t index) {
+  if (index >= MACRO_MAX)
+    return false;
+
+  macro_index = index;
+  macro_code_len = 0;
+  return true;
+}
+
+// Append bytecode to the staged macro
+bool macro_append(const uint8_t *code, size_t len) {
+  if (macro_index < 0 || len > MACRO_CODE_MAX - macro_code_len)
+    return false;
+
+  memcpy(macro_code + macro_code_len, code, len);
+  macro_code_len += len;
+  return true;
+}
+
+// Compile the staged macro and write it to flash
+bool macro_commit(void) {
+  if (macro_index < 0)
+    return false;
+
+  uint8_t index = (uint8_t)macro_index;
+  macro_index = -1;
+
+  if (!macro_compile())
+    return false;
+
+  macro_header_t hdr = {MACRO_MAGIC, macro_count, (uint16_t)~macro_count};
+  memcpy(macro_image, &hdr, sizeof(hdr));
+
+  // program the stream first and the header last, so a macro is only
+  // valid once it was completely written
+  uint32_t offset = macro_offset(index);
+  size_t used = sizeof(hdr) + macro_count * HID_STREAM_REPORT_LEN;
+
+  // playback reads the stream from flash, stop it before rewriting
+  hid_play_stream(NULL, 0);
+  flash_erase_sector(offset);
+  for (size_t page = FLASH_PAGE_SIZE; page < used; page += FLASH_PAGE_SIZE)
+    flash_program_page(offset + page, macro_image + page);
+  flash_program_page(offset, macro_image);
+
+  return true;
+}
+
+// Check if a macro is stored
+bool macro_stored(uint8_t index) { return macro_header(index) != NULL; }
+
+// Play a stored macro
+bool macro_play(uint8_t index) {
+  const macro_header_t *hdr = macro_header(index);
+  if (!hdr)
+    return false;
+
+  hid_play_stream((const uint8_t *)(hdr + 1), hdr->count);
+  return true;
+}
@@ -0,0 +1,24 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#define MACRO_MAX 4        // stored macros
+#define MACRO_CODE_MAX 512 // bytecode size while staging
+
+// Macro bytecode, compiled into a HID report stream when stored
+typedef enum {
+  MACRO_OP_END = 0, // end of macro
+  MACRO_OP_TEXT,    // <len> <chars...>: type text
+  MACRO_OP_CHORD,   // <modifier> <count> <keycodes...>: press and release
+  MACRO_OP_HOLD,    // <modifier>: keep modifiers pressed
+  MACRO_OP_RELEASE, // <modifier>: release held modifiers
+  MACRO_OP_DELAY,   // <ms lo> <ms hi>: pause
+  MACRO_OP_SLOT,    // <block>: type the string stored in a block
+} macro_op_t;
+
+bool macro_begin(uint8_t index);
+bool macro_append(const uint8_t *code, size_t len);
+bool macro_commit(void);
+bool macro_stored(uint8_t index);
+bool macro_play(uint8_t index);
+
+#endif // MACRO_H
@@ -1,10 +1,15 @@
 #include <bsp/board_api.h>
 #include <hardware/gpio.h>
 #include <pico/stdio.h>
+#include <pico/stdlib.h>
 #include <stdlib.h>
 #include <tusb.h>
 
+#include "backup.h"
+#include "counter.h"
 #include "hid.h"
+#include "macro.h"
+#include "stats.h"
 #include "storage.h"
 #include "usb_descriptors.h"
 
@@ -14,6 +19,7 @@ const uint BOOTSEL_PIN = MAX_GPIO - 1;
 const uint BTN_PIN = 29;
 
 static bool gpio_states[MAX_GPIO] = {false};
+static uint32_t bootsel_ms = 0;
 
 // return if button was pressed (just one)
 bool btn_read(const uint pin) {
@@ -53,22 +59,46 @@ int main(void) {
   // let pico sdk use the first cdc interface for std io
   stdio_init_all();
 
+  // recover monotonic counters from flash
+  counter_init();
+
   // GPIO
   gpio_init(BTN_PIN);
 
   // main run loop
+  uint32_t loop_start = time_us_32();
   while (1) {
+    uint32_t now = time_us_32();
+    stats_loop(now - loop_start);
+    loop_start = now;
+
     // TinyUSB device task | must be called regurlarly
     tud_task();
 
     // HID
     hid_task();
 
+    // key store backup over vendor bulk
+    backup_task();
+
+    // BOOTSEL arms backup, read at the same 10ms rate as hid_task
+    if (board_millis() - bootsel_ms >= 10) {
+      bootsel_ms = board_millis();
+      if (btn_read(BOOTSEL_PIN))
+        backup_arm();
+    }
+
     // custom task
     if (btn_read(BTN_PIN)) {
+      // first macro replaces SKEY once it is stored
+      if (macro_play(0)) {
+        printf("Playing macro 0\n");
+        continue;
+      }
+
       const char *msg = flash_read_string(SKEY_BLOCK);
 
-      printf("Typing: %s\n", msg);
+      printf("Typing SKEY\n");
       hid_type_string(msg);
     }
   }
@@ -0,0 +1,24 @@
+#include <string.h>
+
+#include "stats.h"
+
+stats_t stats = {.version = STATS_VERSION};
+
+// Clear all counters
+void stats_reset(void) {
+  memset(&stats, 0, sizeof(stats));
+  stats.version = STATS_VERSION;
+}
+
+// Keep the highest value seen
+void stats_max(uint32_t *max, uint32_t value) {
+  if (value > *max)
+    *max = value;
+}
+
+// Record one main loop iteration
+void stats_loop(uint32_t us) {
+  stats.loop_count++;
+  stats.loop_us_last = us;
+  stats_max(&stats.loop_us_max, us);
+}
@@ -0,0 +1,33 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_VERSION 1
+
+// Device counters, sent as is in the REPORT_ID_STATS feature report
+// (little endian, shared with the host tools)
+typedef struct {
+  uint32_t version;
+  uint32_t uptime_ms;
+  uint32_t hid_reports_sent;
+  uint32_t hid_queue_drops;      // hid_queue_push on a full queue
+  uint32_t hid_queue_depth_max;
+  uint32_t flash_erases;
+  uint32_t flash_erase_us_max;
+  uint32_t flash_programs;
+  uint32_t flash_program_us_max;
+  uint32_t cdc_rx_bytes;
+  uint32_t cdc_commands;
+  uint32_t loop_count;
+  uint32_t loop_us_last;
+  uint32_t loop_us_max;
+} stats_t;
+
+extern stats_t stats;
+
+void stats_reset(void);
+void stats_max(uint32_t *max, uint32_t value);
+void stats_loop(uint32_t us);
+
+#endif // STATS_H
@@ -9,12 +9,11 @@
 #include <pico/stdlib.h>
 
 #include "debug.h"
+#include "stats.h"
 #include "storage.h"
 
 // Pico, Pico W, Pico 2, RP2040, RP2350 have at least 4 MB QSPI Flash
-#define FLASH_TARGET_OFFSET (256 * 1024) // safe offset after program
-#define BLOCK_SIZE 64
-#define MAX_BLOCKS 32
+// Layout of the key store region is defined in storage.h
 
 // ---------- Helpers for flash_safe_execute ----------
 
@@ -32,6 +31,27 @@ static void call_flash_range_program(void *param) {
   flash_range_program(offset, data, FLASH_PAGE_SIZE);
 }
 
+// ---------- Raw flash access ----------
+
+// Erase the sector at offset (must be sector aligned)
+void flash_erase_sector(uint32_t offset) {
+  uint32_t start = time_us_32();
+  flash_safe_execute(call_flash_range_erase, (void *)offset, UINT32_MAX);
+
+  stats.flash_erases++;
+  stats_max(&stats.flash_erase_us_max, time_us_32() - start);
+}
+
+// Program the page at offset (must be page aligned)
+void flash_program_page(uint32_t offset, const uint8_t *data) {
+  uint32_t start = time_us_32();
+  uintptr_t params[] = {offset, (uintptr_t)data};
+  flash_safe_execute(call_flash_range_program, params, UINT32_MAX);
+
+  stats.flash_programs++;
+  stats_max(&stats.flash_program_us_max, time_us_32() - start);
+}
+
 // ---------- Core functions ----------
 
 // Read raw block pointer
@@ -69,11 +89,10 @@ bool flash_write_block(flash_block_t block, const uint8_t *data, size_t len) {
   memcpy(page_buf + offset_in_page, data, len);
 
   // Erase sector first if necessary
-  flash_safe_execute(call_flash_range_erase, (void *)(page_offset), UINT32_MAX);
+  flash_erase_sector(page_offset);
 
   // Program page safely
-  uintptr_t params[] = {page_offset, (uintptr_t)page_buf};
-  flash_safe_execute(call_flash_range_program, params, UINT32_MAX);
+  flash_program_page(page_offset, page_buf);
 
   return true;
 }
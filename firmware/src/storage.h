@@ -1,6 +1,25 @@
 #ifndef STORAGE_H
 #define STORAGE_H
 
+// Flash layout (offsets from the start of flash)
+#define FLASH_TARGET_OFFSET (256 * 1024) // safe offset after program
+#define BLOCK_SIZE 64
+#define MAX_BLOCKS 32
+
+// monotonic counters, two sectors per counter
+#define FLASH_COUNTER_OFFSET (FLASH_TARGET_OFFSET + FLASH_SECTOR_SIZE)
+#define FLASH_COUNTER_SECTORS 4
+
+// compiled macros, one sector per macro
+#define FLASH_MACRO_OFFSET                                                     \
+  (FLASH_COUNTER_OFFSET + FLASH_COUNTER_SECTORS * FLASH_SECTOR_SIZE)
+#define FLASH_MACRO_SECTORS 4
+
+// whole key store, as backed up and restored
+#define FLASH_STORE_SIZE                                                       \
+  (FLASH_MACRO_OFFSET + FLASH_MACRO_SECTORS * FLASH_SECTOR_SIZE -              \
+   FLASH_TARGET_OFFSET)
+
 typedef enum {
   BOOT_BLOCK = 0,
   MKEY_BLOCK,
@@ -13,4 +32,8 @@ bool flash_write_string(flash_block_t block, const char *str);
 const uint8_t *flash_read_block(flash_block_t block);
 const char *flash_read_string(flash_block_t block);
 
-#endif // STORAGE_H
\ No newline at end of file
+// raw flash access, offsets are relative to the start of flash
+void flash_erase_sector(uint32_t offset);
+void flash_program_page(uint32_t offset, const uint8_t *data);
+
+#endif // STORAGE_H
@@ -20,12 +20,21 @@ extern "C"
 // Class
 #define CFG_TUD_CDC 1 // CDC interface for stdio/serial
 #define CFG_TUD_HID 1 // Human Interface Device
+#define CFG_TUD_VENDOR 1 // Vendor bulk interface for key store backup
 
 // Set CDC FIFO buffer sizes
 #define CFG_TUD_CDC_RX_BUFSIZE 64
 #define CFG_TUD_CDC_TX_BUFSIZE 64
 #define CFG_TUD_CDC_EP_BUFSIZE 64
 
+// Vendor FIFOs hold several packets so the endpoints stay double-buffered
+#define CFG_TUD_VENDOR_RX_BUFSIZE 512
+#define CFG_TUD_VENDOR_TX_BUFSIZE 512
+#define CFG_TUD_VENDOR_EPSIZE 64
+
+// HID endpoint and control buffer, fits the stats feature report
+#define CFG_TUD_HID_EP_BUFSIZE 64
+
 // Device
 #ifndef CFG_TUD_ENDPOINT0_SIZE
 #define CFG_TUD_ENDPOINT0_SIZE 64
@@ -1,6 +1,7 @@
 #include <bsp/board_api.h>
 #include <tusb.h>
 
+#include "stats.h"
 #include "usb_descriptors.h"
 
 #define USB_VID 0xBA0C
@@ -36,6 +37,19 @@ uint8_t const *tud_descriptor_device_cb(void);
 // HID Report Descriptor
 uint8_t const desc_hid_report[] = {
     TUD_HID_REPORT_DESC_KEYBOARD(HID_REPORT_ID(REPORT_ID_KEYBOARD)),
+
+    // vendor feature report with device stats
+    HID_USAGE_PAGE_N(HID_USAGE_PAGE_VENDOR, 2),
+    HID_USAGE(0x01),
+    HID_COLLECTION(HID_COLLECTION_APPLICATION),
+    HID_REPORT_ID(REPORT_ID_STATS)
+    HID_USAGE(0x02),
+    HID_LOGICAL_MIN(0x00),
+    HID_LOGICAL_MAX_N(0xff, 2),
+    HID_REPORT_SIZE(8),
+    HID_REPORT_COUNT(sizeof(stats_t)),
+    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+    HID_COLLECTION_END,
 };
 
 // Invoked when received GET HID REPORT DESCRIPTOR
@@ -44,12 +58,10 @@ uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance) {
   return desc_hid_report;
 }
 
-// Define IFTNUM for each descriptor
-enum { ITF_NUM_CDC = 0, ITF_NUM_CDC_DATA, ITF_NUM_HID, ITF_NUM_TOTAL };
-
 // total length of configuration descriptor
 #define CONFIG_TOTAL_LEN                                                       \
-  (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_HID_DESC_LEN)
+  (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_HID_DESC_LEN +                \
+   TUD_VENDOR_DESC_LEN)
 
 // define endpoint numbers
 #define EPNUM_CDC_NOTIF 0x81 // notification endpoint for CDC
@@ -71,6 +83,9 @@ uint8_t const desc_configuration[] = {
     TUD_HID_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE,
                        sizeof(desc_hid_report), EPNUM_HID_IN,
                        CFG_TUD_HID_EP_BUFSIZE, EPNUM_HID_INTERVAL),
+    // Vendor
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 5, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN,
+                          CFG_TUD_VENDOR_EPSIZE),
 };
 
 // called when host requests to get configuration descriptor
@@ -101,6 +116,7 @@ enum {
   STRID_PRODUCT,      // 2: Product
   STRID_SERIAL,       // 3: Serials
   STRID_CDC,          // 4: CDC Interface 0
+  STRID_VENDOR,       // 5: Vendor Interface
 };
 
 // array of pointer to string descriptors
@@ -110,7 +126,8 @@ char const *string_desc_arr[] = {
     "HaoVA",                    // 1: Manufacturer
     "Security Key",             // 2: Product
     NULL,            // 3: Serials (null so it uses unique ID if available)
-    "Pico SDK stdio" // 4: CDC Interface 0
+    "Pico SDK stdio", // 4: CDC Interface 0
+    "Key Store",      // 5: Vendor Interface
 };
 
 // buffer to hold the string descriptor during the request | plus 1 for the null
@@ -7,7 +7,22 @@ enum
   REPORT_ID_MOUSE,
   REPORT_ID_CONSUMER_CONTROL,
   REPORT_ID_GAMEPAD,
+  REPORT_ID_STATS,
   REPORT_ID_COUNT
 };
 
+// Define IFTNUM for each descriptor
+enum
+{
+  ITF_NUM_CDC = 0,
+  ITF_NUM_CDC_DATA,
+  ITF_NUM_HID,
+  ITF_NUM_VENDOR,
+  ITF_NUM_TOTAL
+};
+
+// vendor bulk endpoints, used by the host tools
+#define EPNUM_VENDOR_OUT 0x04
+#define EPNUM_VENDOR_IN 0x84
+
 #endif /* USB_DESCRIPTORS_H_ */
@@ -0,0 +1,502 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/usbdevice_fs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "backup.h"
+#include "crc32.h"
+#include "usb_descriptors.h"
+
+// Key store backup and restore over the vendor bulk interface, talking to
+// usbfs directly so no USB library is needed.
+
+#define USB_VID "ba0c"
+#define USB_PID "0001"
+
+#define SECTOR_SIZE 4096  // FLASH_SECTOR_SIZE on the device
+#define READ_WINDOW 8     // READ requests in flight, fits the device FIFO
+#define TIMEOUT_MS 5000   // a sector erase stalls the device
+
+typedef struct {
+  int fd;
+  uint8_t buf[SECTOR_SIZE]; // IN data not consumed yet
+  size_t pos;
+  size_t len;
+} link_t;
+
+// ---------- USB ----------
+
+static bool read_attr(const char *dir, const char *name, char *buf,
+                      size_t size) {
+  char path[512];
+  snprintf(path, sizeof(path), "/sys/bus/usb/devices/%s/%s", dir, name);
+
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return false;
+
+  bool ok = fgets(buf, size, f) != NULL;
+  fclose(f);
+  if (ok)
+    buf[strcspn(buf, "\n")] = 0;
+  return ok;
+}
+
+// Find the key in sysfs and open its usbfs node
+static int open_device(const char *serial) {
+  DIR *dir = opendir("/sys/bus/usb/devices");
+  if (!dir) {
+    perror("/sys/bus/usb/devices");
+    return -1;
+  }
+
+  int fd = -1;
+  struct dirent *ent;
+  while (fd < 0 && (ent = readdir(dir)) != NULL) {
+    char vid[8], pid[8], sn[64], bus[8], dev[8];
+
+    // interfaces have a ':' in their name
+    if (ent->d_name[0] == '.' || strchr(ent->d_name, ':'))
+      continue;
+    if (!read_attr(ent->d_name, "idVendor", vid, sizeof(vid)) ||
+        !read_attr(ent->d_name, "idProduct", pid, sizeof(pid)) ||
+        strcmp(vid, USB_VID) != 0 || strcmp(pid, USB_PID) != 0)
+      continue;
+    if (serial && (!read_attr(ent->d_name, "serial", sn, sizeof(sn)) ||
+                   strcmp(sn, serial) != 0))
+      continue;
+    if (!read_attr(ent->d_name, "busnum", bus, sizeof(bus)) ||
+        !read_attr(ent->d_name, "devnum", dev, sizeof(dev)))
+      continue;
+
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/bus/usb/%03d/%03d", atoi(bus),
+             atoi(dev));
+    fd = open(path, O_RDWR);
+    if (fd < 0)
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+  }
+  closedir(dir);
+
+  if (fd < 0)
+    return -1;
+
+  unsigned int itf = ITF_NUM_VENDOR;
+  if (ioctl(fd, USBDEVFS_CLAIMINTERFACE, &itf) != 0) {
+    perror("claim interface");
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static int link_write(link_t *link, const void *data, size_t len) {
+  struct usbdevfs_bulktransfer bulk = {
+      .ep = EPNUM_VENDOR_OUT,
+      .len = len,
+      .timeout = TIMEOUT_MS,
+      .data = (void *)data,
+  };
+
+  if (ioctl(link->fd, USBDEVFS_BULK, &bulk) != (int)len) {
+    perror("bulk out");
+    return -1;
+  }
+  return 0;
+}
+
+// Read exactly len bytes of the IN stream
+static int link_read(link_t *link, void *data, size_t len) {
+  uint8_t *out = data;
+
+  while (len > 0) {
+    if (link->pos == link->len) {
+      // whole packets only, the device may send more than asked for
+      struct usbdevfs_bulktransfer bulk = {
+          .ep = EPNUM_VENDOR_IN,
+          .len = sizeof(link->buf),
+          .timeout = TIMEOUT_MS,
+          .data = link->buf,
+      };
+      int n = ioctl(link->fd, USBDEVFS_BULK, &bulk);
+      if (n < 0) {
+        perror("bulk in");
+        return -1;
+      }
+      link->pos = 0;
+      link->len = n;
+      continue;
+    }
+
+    size_t n = link->len - link->pos;
+    if (n > len)
+      n = len;
+    memcpy(out, link->buf + link->pos, n);
+    link->pos += n;
+    out += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+// ---------- Protocol ----------
+
+static int send_request(link_t *link, uint8_t op, uint32_t offset,
+                        uint32_t length, uint32_t crc) {
+  backup_header_t req = {
+      .magic = BACKUP_MAGIC,
+      .op = op,
+      .offset = offset,
+      .length = length,
+      .crc = crc,
+  };
+  return link_write(link, &req, sizeof(req));
+}
+
+static int read_reply(link_t *link, uint8_t op, backup_header_t *reply) {
+  if (link_read(link, reply, sizeof(*reply)) != 0)
+    return -1;
+
+  if (reply->magic != BACKUP_MAGIC || reply->op != op) {
+    fprintf(stderr, "unexpected reply\n");
+    return -1;
+  }
+  if (reply->status == BACKUP_STATUS_NOT_ARMED) {
+    fprintf(stderr, "key is not armed, press its BOOTSEL button\n");
+    return -1;
+  }
+  if (reply->status != BACKUP_STATUS_OK &&
+      reply->status != BACKUP_STATUS_MERGED) {
+    fprintf(stderr, "device error %u at offset %u\n", reply->status,
+            reply->offset);
+    return -1;
+  }
+  return 0;
+}
+
+static int store_info(link_t *link, backup_header_t *info) {
+  if (send_request(link, BACKUP_OP_INFO, 0, 0, 0) != 0)
+    return -1;
+  return read_reply(link, BACKUP_OP_INFO, info);
+}
+
+static int store_crc(link_t *link, uint32_t offset, uint32_t length,
+                     uint32_t *crc) {
+  backup_header_t reply;
+  if (send_request(link, BACKUP_OP_CRC, offset, length, 0) != 0 ||
+      read_reply(link, BACKUP_OP_CRC, &reply) != 0)
+    return -1;
+  *crc = reply.crc;
+  return 0;
+}
+
+// Wait for the user to press BOOTSEL on the key
+static int wait_armed(link_t *link) {
+  bool prompted = false;
+
+  for (int i = 0; i < BACKUP_ARM_MS / 500; i++) {
+    backup_header_t reply;
+    if (send_request(link, BACKUP_OP_CRC, 0, 0, 0) != 0 ||
+        link_read(link, &reply, sizeof(reply)) != 0)
+      return -1;
+    if (reply.magic != BACKUP_MAGIC) {
+      fprintf(stderr, "unexpected reply\n");
+      return -1;
+    }
+    if (reply.status == BACKUP_STATUS_OK)
+      return 0;
+
+    if (!prompted) {
+      printf("Press the BOOTSEL button on the key to allow access\n");
+      fflush(stdout);
+      prompted = true;
+    }
+    usleep(500 * 1000);
+  }
+
+  fprintf(stderr, "key was not armed\n");
+  return -1;
+}
+
+// CRC of the first len bytes of a file
+static int file_crc(int fd, uint32_t len, uint32_t *crc) {
+  uint8_t buf[SECTOR_SIZE];
+
+  *crc = 0;
+  for (uint32_t offset = 0; offset < len; offset += SECTOR_SIZE) {
+    uint32_t n = len - offset < SECTOR_SIZE ? len - offset : SECTOR_SIZE;
+    if (pread(fd, buf, n, offset) != (ssize_t)n)
+      return -1;
+    *crc = crc32_update(*crc, buf, n);
+  }
+  return 0;
+}
+
+static double elapsed_s(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// ---------- Commands ----------
+
+// Stream the store into a file, resuming after its last whole sector
+static int backup(link_t *link, const char *path) {
+  backup_header_t info;
+  if (store_info(link, &info) != 0 || wait_armed(link) != 0)
+    return -1;
+
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  uint32_t offset = 0;
+  if ((uint64_t)st.st_size <= info.length)
+    offset = st.st_size - st.st_size % SECTOR_SIZE;
+
+  // only resume a file that holds this key's data
+  if (offset) {
+    uint32_t crc, device_crc;
+    if (file_crc(fd, offset, &crc) != 0 ||
+        store_crc(link, 0, offset, &device_crc) != 0) {
+      close(fd);
+      return -1;
+    }
+    if (crc == device_crc) {
+      printf("Resuming at offset %u\n", offset);
+    } else {
+      printf("Existing file does not match the key, starting over\n");
+      offset = 0;
+    }
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // keep several sector reads queued on the device
+  uint32_t requested = offset;
+  uint32_t received = offset;
+  uint8_t sector[SECTOR_SIZE];
+  int ret = 0;
+
+  while (received < info.length && ret == 0) {
+    while (requested < info.length &&
+           requested - received < READ_WINDOW * SECTOR_SIZE) {
+      uint32_t len = info.length - requested;
+      if (len > SECTOR_SIZE)
+        len = SECTOR_SIZE;
+      if (send_request(link, BACKUP_OP_READ, requested, len, 0) != 0) {
+        ret = -1;
+        break;
+      }
+      requested += len;
+    }
+    if (ret != 0)
+      break;
+
+    backup_header_t reply;
+    if (read_reply(link, BACKUP_OP_READ, &reply) != 0 ||
+        reply.offset != received || reply.length > SECTOR_SIZE ||
+        link_read(link, sector, reply.length) != 0) {
+      ret = -1;
+      break;
+    }
+
+    if (crc32_update(0, sector, reply.length) != reply.crc) {
+      fprintf(stderr, "crc mismatch at offset %u\n", reply.offset);
+      ret = -1;
+      break;
+    }
+
+    if (pwrite(fd, sector, reply.length, reply.offset) !=
+        (ssize_t)reply.length) {
+      perror(path);
+      ret = -1;
+      break;
+    }
+    received += reply.length;
+  }
+
+  if (ret == 0 && ftruncate(fd, info.length) != 0) {
+    perror(path);
+    ret = -1;
+  }
+
+  // the whole file must match the store as it is now
+  uint32_t crc = 0;
+  if (ret == 0 && (file_crc(fd, info.length, &crc) != 0 ||
+                   store_info(link, &info) != 0)) {
+    perror(path);
+    ret = -1;
+  }
+  if (ret == 0 && crc != info.crc) {
+    fprintf(stderr, "verify failed: device crc %08x, file crc %08x\n",
+            info.crc, crc);
+    ret = -1;
+  }
+  close(fd);
+  if (ret != 0)
+    return ret;
+
+  double s = elapsed_s(&start);
+  printf("Backed up %u bytes in %.2f s (%.0f KB/s), crc %08x\n",
+         info.length - offset, s, (info.length - offset) / 1024.0 / s,
+         info.crc);
+  return 0;
+}
+
+// Write a backup back, skipping sectors that already match
+static int restore(link_t *link, const char *path) {
+  backup_header_t info;
+  if (store_info(link, &info) != 0)
+    return -1;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  if ((uint64_t)st.st_size != info.length || info.length % SECTOR_SIZE) {
+    fprintf(stderr, "%s: expected %u bytes\n", path, info.length);
+    close(fd);
+    return -1;
+  }
+
+  if (wait_armed(link) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  // counter sectors are merged by the device, not copied
+  bool *merged = calloc(info.length / SECTOR_SIZE, sizeof(bool));
+  uint8_t sector[SECTOR_SIZE];
+  uint32_t written = 0;
+  int ret = merged ? 0 : -1;
+
+  for (uint32_t offset = 0; offset < info.length && ret == 0;
+       offset += SECTOR_SIZE) {
+    if (pread(fd, sector, SECTOR_SIZE, offset) != SECTOR_SIZE) {
+      perror(path);
+      ret = -1;
+      break;
+    }
+
+    // an interrupted restore resumes where the device differs
+    uint32_t crc = crc32_update(0, sector, SECTOR_SIZE);
+    uint32_t device_crc;
+    if (store_crc(link, offset, SECTOR_SIZE, &device_crc) != 0) {
+      ret = -1;
+      break;
+    }
+    if (device_crc == crc)
+      continue;
+
+    // the sector is only sent once the device acked the header
+    backup_header_t reply;
+    if (send_request(link, BACKUP_OP_WRITE, offset, SECTOR_SIZE, crc) != 0 ||
+        read_reply(link, BACKUP_OP_WRITE, &reply) != 0 ||
+        link_write(link, sector, SECTOR_SIZE) != 0 ||
+        read_reply(link, BACKUP_OP_WRITE, &reply) != 0) {
+      ret = -1;
+      break;
+    }
+
+    if (reply.status == BACKUP_STATUS_MERGED)
+      merged[offset / SECTOR_SIZE] = true;
+    else
+      written += SECTOR_SIZE;
+  }
+
+  // verify every copied sector
+  for (uint32_t offset = 0; offset < info.length && ret == 0;
+       offset += SECTOR_SIZE) {
+    uint32_t crc, device_crc;
+    if (merged[offset / SECTOR_SIZE])
+      continue;
+    if (pread(fd, sector, SECTOR_SIZE, offset) != SECTOR_SIZE ||
+        store_crc(link, offset, SECTOR_SIZE, &device_crc) != 0) {
+      ret = -1;
+      break;
+    }
+    crc = crc32_update(0, sector, SECTOR_SIZE);
+    if (crc != device_crc) {
+      fprintf(stderr, "verify failed at offset %u\n", offset);
+      ret = -1;
+    }
+  }
+
+  free(merged);
+  close(fd);
+  if (ret != 0)
+    return ret;
+
+  printf("Restored %u of %u bytes in %.2f s, counters merged\n", written,
+         info.length, elapsed_s(&start));
+  return 0;
+}
+
+// ---------- Main ----------
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-s serial] backup|restore <file>\n", prog);
+}
+
+int main(int argc, char **argv) {
+  const char *serial = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:")) != -1) {
+    if (opt != 's') {
+      usage(argv[0]);
+      return 1;
+    }
+    serial = optarg;
+  }
+
+  if (optind != argc - 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const char *cmd = argv[optind];
+  const char *path = argv[optind + 1];
+  if (strcmp(cmd, "backup") != 0 && strcmp(cmd, "restore") != 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  link_t link = {.fd = open_device(serial)};
+  if (link.fd < 0) {
+    fprintf(stderr, "device not found\n");
+    return 1;
+  }
+
+  int ret = strcmp(cmd, "backup") == 0 ? backup(&link, path)
+                                       : restore(&link, path);
+
+  unsigned int itf = ITF_NUM_VENDOR;
+  ioctl(link.fd, USBDEVFS_RELEASEINTERFACE, &itf);
+  close(link.fd);
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,663 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serial.h"
+
+// Device daemon: owns every attached key and multiplexes clients onto it.
+//
+// Clients connect to a Unix socket and send one request per line:
+//   DEVICES                   attached keys: <serial> <version> <tty>
+//   INFO <serial>             serial, version and slot list, cached for 2 s
+//   SEND <serial> <command>   forward a serial command, return its output
+// <serial> may be "-" for the first attached key. Every reply ends with a
+// line holding a single ".", errors are a single "ERR <reason>" line.
+//
+// The firmware reads one command per USB packet and has no reply framing,
+// so each key runs one command at a time and its output is collected until
+// the line is quiet. Whatever else the key prints meanwhile (e.g. on a button
+// press) lands in that reply too, so the firmware never prints key material.
+
+#define USB_VID "ba0c"
+#define USB_PID "0001"
+
+#define MAX_DEVICES 16
+#define MAX_CLIENTS 128
+#define LINE_MAX_LEN 512
+#define COMMAND_MAX_LEN 64 // CFG_TUD_CDC_RX_BUFSIZE on the device
+#define RESPONSE_MAX_LEN 4096
+
+#define RESPONSE_TIMEOUT_MS 1000 // wait for the first byte
+#define RESPONSE_QUIET_MS 100    // then until the line is quiet
+
+// slots also change behind our back, e.g. by a keybackup restore
+#define SLOTS_MAX_AGE_MS 2000
+
+typedef enum { REQ_SEND, REQ_INFO } request_kind_t;
+
+typedef struct {
+  int fd;
+  char line[LINE_MAX_LEN];
+  size_t line_len;
+  bool busy; // waiting for a device reply
+} client_t;
+
+typedef struct {
+  int client; // index in clients, -1 for an internal refresh
+  request_kind_t kind;
+  char command[COMMAND_MAX_LEN + 1];
+} request_t;
+
+typedef struct {
+  bool used;
+  char tty[32];
+  int fd;
+
+  // read-only state, served without touching USB
+  char serial[64];
+  char version[8];
+  char slots[128];
+  bool slots_valid;
+  uint64_t slots_ms; // when the slot list was read
+
+  // pending requests, the head one is in flight when active
+  request_t queue[MAX_CLIENTS];
+  size_t head;
+  size_t count;
+  bool active;
+  char response[RESPONSE_MAX_LEN];
+  size_t response_len;
+  uint64_t deadline_ms;
+} device_t;
+
+static device_t devices[MAX_DEVICES];
+static client_t clients[MAX_CLIENTS];
+static volatile sig_atomic_t running = 1;
+
+// ---------- Helpers ----------
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void on_signal(int sig) {
+  (void)sig;
+  running = 0;
+}
+
+// Read one line of a sysfs attribute
+static bool read_attr(const char *path, char *buf, size_t size) {
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return false;
+
+  bool ok = fgets(buf, size, f) != NULL;
+  fclose(f);
+  if (ok)
+    buf[strcspn(buf, "\n")] = 0;
+  return ok;
+}
+
+static void client_write(int client, const char *buf, size_t len) {
+  // send timeout on the socket keeps a stuck client from blocking us
+  while (len > 0) {
+    ssize_t n = send(clients[client].fd, buf, len, MSG_NOSIGNAL);
+    if (n <= 0)
+      return;
+    buf += n;
+    len -= n;
+  }
+}
+
+static void client_reply(int client, const char *msg) {
+  client_write(client, msg, strlen(msg));
+}
+
+static void client_close(int client) {
+  close(clients[client].fd);
+  clients[client].fd = -1;
+
+  // drop its queued requests, an in flight one is answered to nobody
+  for (int d = 0; d < MAX_DEVICES; d++) {
+    for (size_t i = 0; i < devices[d].count; i++) {
+      request_t *req = &devices[d].queue[(devices[d].head + i) % MAX_CLIENTS];
+      if (req->client == client)
+        req->client = -1;
+    }
+  }
+}
+
+static bool slots_fresh(const device_t *dev) {
+  return dev->slots_valid && now_ms() - dev->slots_ms < SLOTS_MAX_AGE_MS;
+}
+
+static void reply_info(int client, const device_t *dev) {
+  char buf[512];
+  snprintf(buf, sizeof(buf), "serial %s\nversion %s\nslots %s\n.\n",
+           dev->serial, dev->version, dev->slots);
+  client_reply(client, buf);
+}
+
+// ---------- Devices ----------
+
+static void device_start_next(device_t *dev);
+
+static bool device_enqueue(device_t *dev, int client, request_kind_t kind,
+                           const char *command) {
+  if (dev->count == MAX_CLIENTS)
+    return false;
+
+  request_t *req = &dev->queue[(dev->head + dev->count) % MAX_CLIENTS];
+  req->client = client;
+  req->kind = kind;
+  snprintf(req->command, sizeof(req->command), "%s", command);
+  dev->count++;
+
+  if (!dev->active)
+    device_start_next(dev);
+  return true;
+}
+
+// Write the head request to the key
+static void device_start_next(device_t *dev) {
+  while (dev->count > 0 && !dev->active) {
+    request_t *req = &dev->queue[dev->head];
+
+    // answer from cache when a refresh finished in the meantime
+    if (req->kind == REQ_INFO && slots_fresh(dev)) {
+      if (req->client >= 0) {
+        reply_info(req->client, dev);
+        clients[req->client].busy = false;
+      }
+      dev->head = (dev->head + 1) % MAX_CLIENTS;
+      dev->count--;
+      continue;
+    }
+
+    // one packet, the firmware handles one command per packet
+    size_t len = strlen(req->command);
+    if (write(dev->fd, req->command, len) != (ssize_t)len) {
+      if (req->client >= 0) {
+        client_reply(req->client, "ERR write failed\n");
+        clients[req->client].busy = false;
+      }
+      dev->head = (dev->head + 1) % MAX_CLIENTS;
+      dev->count--;
+      continue;
+    }
+
+    dev->active = true;
+    dev->response_len = 0;
+    dev->deadline_ms = now_ms() + RESPONSE_TIMEOUT_MS;
+  }
+}
+
+// Line went quiet: hand the output to the waiting client
+static void device_finish(device_t *dev) {
+  request_t *req = &dev->queue[dev->head];
+  dev->response[dev->response_len] = 0;
+
+  if (req->kind == REQ_INFO) {
+    // LIST reply, e.g. "Slots: MKEY SKEY M0"
+    const char *slots = strstr(dev->response, "Slots:");
+    if (slots) {
+      slots += strlen("Slots:");
+      slots += strspn(slots, " ");
+      snprintf(dev->slots, sizeof(dev->slots), "%.*s",
+               (int)strcspn(slots, "\r\n"), slots);
+      dev->slots_valid = true;
+      dev->slots_ms = now_ms();
+    }
+
+    if (req->client >= 0) {
+      if (dev->slots_valid)
+        reply_info(req->client, dev);
+      else
+        client_reply(req->client, "ERR no slot list\n");
+    }
+  } else {
+    // anything but a read may change the slots
+    if (strncmp(req->command, "LIST", 4) != 0)
+      dev->slots_valid = false;
+
+    if (req->client >= 0) {
+      client_write(req->client, dev->response, dev->response_len);
+      if (dev->response_len && dev->response[dev->response_len - 1] != '\n')
+        client_reply(req->client, "\n");
+      client_reply(req->client, ".\n");
+    }
+  }
+
+  if (req->client >= 0)
+    clients[req->client].busy = false;
+
+  dev->head = (dev->head + 1) % MAX_CLIENTS;
+  dev->count--;
+  dev->active = false;
+  device_start_next(dev);
+}
+
+static void device_remove(device_t *dev) {
+  printf("Removed %s (%s)\n", dev->tty, dev->serial);
+
+  for (size_t i = 0; i < dev->count; i++) {
+    request_t *req = &dev->queue[(dev->head + i) % MAX_CLIENTS];
+    if (req->client >= 0) {
+      client_reply(req->client, "ERR device removed\n");
+      clients[req->client].busy = false;
+    }
+  }
+
+  close(dev->fd);
+  memset(dev, 0, sizeof(*dev));
+  dev->fd = -1;
+}
+
+static void device_add(const char *tty) {
+  char path[512];
+  char vid[8], pid[8];
+
+  // USB device is the parent of the CDC interface
+  snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../idVendor", tty);
+  if (!read_attr(path, vid, sizeof(vid)) || strcmp(vid, USB_VID) != 0)
+    return;
+  snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../idProduct", tty);
+  if (!read_attr(path, pid, sizeof(pid)) || strcmp(pid, USB_PID) != 0)
+    return;
+
+  device_t *dev = NULL;
+  for (int d = 0; d < MAX_DEVICES && !dev; d++) {
+    if (!devices[d].used)
+      dev = &devices[d];
+  }
+  if (!dev) {
+    fprintf(stderr, "%s: too many devices\n", tty);
+    return;
+  }
+
+  // node may not be accessible yet, retried on the next attribute change
+  snprintf(path, sizeof(path), "/dev/%s", tty);
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0)
+    return;
+
+  // configured once for the lifetime of the key
+  if (configure_serial(fd, B115200) != 0) {
+    close(fd);
+    return;
+  }
+  tcflush(fd, TCIOFLUSH);
+
+  memset(dev, 0, sizeof(*dev));
+  dev->used = true;
+  dev->fd = fd;
+  snprintf(dev->tty, sizeof(dev->tty), "%.31s", tty);
+
+  snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../serial", tty);
+  if (!read_attr(path, dev->serial, sizeof(dev->serial)))
+    snprintf(dev->serial, sizeof(dev->serial), "%.63s", tty);
+  snprintf(path, sizeof(path), "/sys/class/tty/%s/device/../bcdDevice", tty);
+  if (!read_attr(path, dev->version, sizeof(dev->version)))
+    snprintf(dev->version, sizeof(dev->version), "unknown");
+
+  printf("Added %s (%s, version %s)\n", dev->tty, dev->serial, dev->version);
+
+  // warm the slot cache
+  device_enqueue(dev, -1, REQ_INFO, "LIST");
+}
+
+// Match /dev/ttyACM* against the known devices
+static void scan_devices(void) {
+  DIR *dir = opendir("/sys/class/tty");
+  if (!dir)
+    return;
+
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, "ttyACM", 6) != 0)
+      continue;
+
+    bool known = false;
+    for (int d = 0; d < MAX_DEVICES && !known; d++)
+      known = devices[d].used && strcmp(devices[d].tty, ent->d_name) == 0;
+    if (!known)
+      device_add(ent->d_name);
+  }
+  closedir(dir);
+
+  // node gone without a hangup seen yet
+  for (int d = 0; d < MAX_DEVICES; d++) {
+    char path[64];
+    snprintf(path, sizeof(path), "/dev/%s", devices[d].tty);
+    if (devices[d].used && access(path, F_OK) != 0)
+      device_remove(&devices[d]);
+  }
+}
+
+static device_t *find_device(const char *serial) {
+  for (int d = 0; d < MAX_DEVICES; d++) {
+    if (devices[d].used &&
+        (strcmp(serial, "-") == 0 || strcmp(devices[d].serial, serial) == 0))
+      return &devices[d];
+  }
+  return NULL;
+}
+
+static void device_read(device_t *dev) {
+  char buf[256];
+  ssize_t n = read(dev->fd, buf, sizeof(buf));
+
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+    device_remove(dev);
+    return;
+  }
+  if (n < 0 || !dev->active)
+    return; // unsolicited output (e.g. button press) is dropped
+
+  size_t room = RESPONSE_MAX_LEN - 1 - dev->response_len;
+  if ((size_t)n > room)
+    n = room;
+  memcpy(dev->response + dev->response_len, buf, n);
+  dev->response_len += n;
+  dev->deadline_ms = now_ms() + RESPONSE_QUIET_MS;
+}
+
+// ---------- Clients ----------
+
+static void handle_request(int client, char *line) {
+  char *verb = strtok(line, " ");
+  char *serial = strtok(NULL, " ");
+  char *command = strtok(NULL, "");
+
+  if (!verb) {
+    client_reply(client, "ERR empty request\n");
+    return;
+  }
+
+  if (strcmp(verb, "DEVICES") == 0) {
+    char buf[256];
+    for (int d = 0; d < MAX_DEVICES; d++) {
+      if (!devices[d].used)
+        continue;
+      snprintf(buf, sizeof(buf), "%s %s %s\n", devices[d].serial,
+               devices[d].version, devices[d].tty);
+      client_reply(client, buf);
+    }
+    client_reply(client, ".\n");
+    return;
+  }
+
+  if (strcmp(verb, "INFO") != 0 && strcmp(verb, "SEND") != 0) {
+    client_reply(client, "ERR unknown request\n");
+    return;
+  }
+
+  if (!serial) {
+    client_reply(client, "ERR missing serial\n");
+    return;
+  }
+
+  device_t *dev = find_device(serial);
+  if (!dev) {
+    client_reply(client, "ERR no such device\n");
+    return;
+  }
+
+  if (strcmp(verb, "INFO") == 0) {
+    if (slots_fresh(dev)) {
+      reply_info(client, dev);
+    } else if (device_enqueue(dev, client, REQ_INFO, "LIST")) {
+      clients[client].busy = true;
+    } else {
+      client_reply(client, "ERR device busy\n");
+    }
+    return;
+  }
+
+  // SEND
+  if (!command || strlen(command) > COMMAND_MAX_LEN) {
+    client_reply(client, "ERR bad command\n");
+  } else if (device_enqueue(dev, client, REQ_SEND, command)) {
+    clients[client].busy = true;
+  } else {
+    client_reply(client, "ERR device busy\n");
+  }
+}
+
+// Handle buffered lines, one request at a time per client
+static void client_process(int client) {
+  client_t *c = &clients[client];
+  char *eol;
+
+  while (!c->busy && (eol = memchr(c->line, '\n', c->line_len)) != NULL) {
+    *eol = 0;
+    if (eol > c->line && eol[-1] == '\r')
+      eol[-1] = 0;
+
+    char request[LINE_MAX_LEN];
+    snprintf(request, sizeof(request), "%s", c->line);
+
+    c->line_len -= eol + 1 - c->line;
+    memmove(c->line, eol + 1, c->line_len);
+    handle_request(client, request);
+  }
+}
+
+static void client_read(int client) {
+  client_t *c = &clients[client];
+  ssize_t n = recv(c->fd, c->line + c->line_len,
+                   sizeof(c->line) - 1 - c->line_len, 0);
+
+  if (n <= 0) {
+    client_close(client);
+    return;
+  }
+  c->line_len += n;
+
+  client_process(client);
+
+  // full without a complete request in it
+  if (c->line_len == sizeof(c->line) - 1 &&
+      !memchr(c->line, '\n', c->line_len)) {
+    client_reply(client, "ERR line too long\n");
+    client_close(client);
+  }
+}
+
+static void client_accept(int server) {
+  int fd = accept(server, NULL, NULL);
+  if (fd < 0)
+    return;
+
+  for (int i = 0; i < MAX_CLIENTS; i++) {
+    if (clients[i].fd < 0) {
+      struct timeval tv = {.tv_sec = 1};
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+      clients[i].fd = fd;
+      clients[i].line_len = 0;
+      clients[i].busy = false;
+      return;
+    }
+  }
+
+  // full
+  close(fd);
+}
+
+// ---------- Main ----------
+
+static int open_server(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "%s: path too long\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 16) != 0) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int main(int argc, char **argv) {
+  char default_path[256];
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  snprintf(default_path, sizeof(default_path), "%s/security-key.sock",
+           runtime ? runtime : "/tmp");
+
+  const char *path = default_path;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:")) != -1) {
+    if (opt != 's') {
+      fprintf(stderr, "usage: %s [-s socket]\n", argv[0]);
+      return 1;
+    }
+    path = optarg;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  int server = open_server(path);
+  if (server < 0)
+    return 1;
+
+  // hotplug: tty nodes appear, get their permissions and vanish in /dev
+  int inotify = inotify_init1(IN_NONBLOCK);
+  if (inotify < 0 ||
+      inotify_add_watch(inotify, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB) <
+          0) {
+    perror("inotify");
+    return 1;
+  }
+
+  for (int d = 0; d < MAX_DEVICES; d++)
+    devices[d].fd = -1;
+  for (int i = 0; i < MAX_CLIENTS; i++)
+    clients[i].fd = -1;
+
+  scan_devices();
+  printf("Listening on %s\n", path);
+  fflush(stdout);
+
+  struct pollfd fds[2 + MAX_DEVICES + MAX_CLIENTS];
+  int owner[2 + MAX_DEVICES + MAX_CLIENTS]; // device d or client -1 - i
+
+  while (running) {
+    int nfds = 0;
+    fds[nfds++] = (struct pollfd){.fd = server, .events = POLLIN};
+    fds[nfds++] = (struct pollfd){.fd = inotify, .events = POLLIN};
+
+    // sleep until the nearest response deadline
+    int timeout = -1;
+    uint64_t now = now_ms();
+    for (int d = 0; d < MAX_DEVICES; d++) {
+      if (!devices[d].used)
+        continue;
+      if (devices[d].active) {
+        int left = devices[d].deadline_ms > now
+                       ? (int)(devices[d].deadline_ms - now)
+                       : 0;
+        if (timeout < 0 || left < timeout)
+          timeout = left;
+      }
+      owner[nfds] = d;
+      fds[nfds++] = (struct pollfd){.fd = devices[d].fd, .events = POLLIN};
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+      if (clients[i].fd < 0)
+        continue;
+      // busy clients are read once their reply is out
+      owner[nfds] = -1 - i;
+      fds[nfds++] = (struct pollfd){
+          .fd = clients[i].fd, .events = clients[i].busy ? 0 : POLLIN};
+    }
+
+    if (poll(fds, nfds, timeout) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+
+    if (fds[0].revents & POLLIN)
+      client_accept(server);
+
+    if (fds[1].revents & POLLIN) {
+      char buf[4096];
+      while (read(inotify, buf, sizeof(buf)) > 0)
+        ;
+      scan_devices();
+    }
+
+    for (int i = 2; i < nfds; i++) {
+      if (!fds[i].revents)
+        continue;
+
+      if (owner[i] >= 0) {
+        if (devices[owner[i]].used && devices[owner[i]].fd == fds[i].fd)
+          device_read(&devices[owner[i]]);
+      } else {
+        int client = -1 - owner[i];
+        if (clients[client].fd != fds[i].fd)
+          continue;
+        if (clients[client].busy)
+          client_close(client); // hangup while waiting for a reply
+        else
+          client_read(client);
+      }
+    }
+
+    // finish responses whose line went quiet
+    now = now_ms();
+    for (int d = 0; d < MAX_DEVICES; d++) {
+      if (devices[d].used && devices[d].active && devices[d].deadline_ms <= now)
+        device_finish(&devices[d]);
+    }
+
+    // clients freed by a finished request may have more lines buffered
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+      if (clients[i].fd >= 0 && !clients[i].busy &&
+          memchr(clients[i].line, '\n', clients[i].line_len))
+        client_process(i);
+    }
+  }
+
+  for (int d = 0; d < MAX_DEVICES; d++) {
+    if (devices[d].used)
+      close(devices[d].fd);
+  }
+  close(server);
+  unlink(path);
+  return 0;
+}
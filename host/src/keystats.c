@@ -0,0 +1,137 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#include <hidapi.h>
+
+#include "stats.h"
+#include "usb_descriptors.h"
+
+#define USB_VID 0xBA0C
+#define USB_PID 0x0001
+
+// Read the stats feature report
+static int read_stats(hid_device *dev, stats_t *out) {
+  uint8_t buf[1 + sizeof(stats_t)] = {REPORT_ID_STATS};
+
+  int n = hid_get_feature_report(dev, buf, sizeof(buf));
+  if (n < 0) {
+    fprintf(stderr, "get feature report: %ls\n", hid_error(dev));
+    return -1;
+  }
+
+  // first byte is the report id
+  memset(out, 0, sizeof(*out));
+  memcpy(out, buf + 1, n > 1 ? (size_t)n - 1 : 0);
+  return 0;
+}
+
+// Writing the stats feature report resets the counters
+static int reset_stats(hid_device *dev) {
+  uint8_t buf[1 + sizeof(stats_t)] = {REPORT_ID_STATS};
+
+  if (hid_send_feature_report(dev, buf, sizeof(buf)) < 0) {
+    fprintf(stderr, "send feature report: %ls\n", hid_error(dev));
+    return -1;
+  }
+  return 0;
+}
+
+static void print_stats(const stats_t *s) {
+  printf("uptime            %u ms\n", s->uptime_ms);
+  printf("hid reports sent  %u\n", s->hid_reports_sent);
+  printf("hid queue drops   %u\n", s->hid_queue_drops);
+  printf("hid queue max     %u\n", s->hid_queue_depth_max);
+  printf("flash erases      %u (max %u us)\n", s->flash_erases,
+         s->flash_erase_us_max);
+  printf("flash programs    %u (max %u us)\n", s->flash_programs,
+         s->flash_program_us_max);
+  printf("cdc rx bytes      %u\n", s->cdc_rx_bytes);
+  printf("cdc commands      %u\n", s->cdc_commands);
+  printf("loop iterations   %u (last %u us, max %u us)\n", s->loop_count,
+         s->loop_us_last, s->loop_us_max);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-s serial] [-i interval_ms] [reset]\n", prog);
+}
+
+int main(int argc, char **argv) {
+  const char *serial = NULL;
+  long interval_ms = 0;
+  bool reset = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:i:")) != -1) {
+    switch (opt) {
+    case 's':
+      serial = optarg;
+      break;
+    case 'i':
+      interval_ms = atol(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind < argc) {
+    if (optind != argc - 1 || strcmp(argv[optind], "reset") != 0) {
+      usage(argv[0]);
+      return 1;
+    }
+    reset = true;
+  }
+
+  if (hid_init() != 0) {
+    fprintf(stderr, "hid_init failed\n");
+    return 1;
+  }
+
+  // open by serial when several keys are attached
+  wchar_t wserial[64];
+  if (serial)
+    swprintf(wserial, sizeof(wserial) / sizeof(wserial[0]), L"%s", serial);
+
+  hid_device *dev = hid_open(USB_VID, USB_PID, serial ? wserial : NULL);
+  if (!dev) {
+    fprintf(stderr, "device not found\n");
+    hid_exit();
+    return 1;
+  }
+
+  int ret = 0;
+  stats_t stats;
+
+  if (reset) {
+    ret = reset_stats(dev);
+  } else {
+    do {
+      if (read_stats(dev, &stats) != 0) {
+        ret = -1;
+        break;
+      }
+      if (stats.version != STATS_VERSION) {
+        fprintf(stderr, "unsupported stats version %u\n", stats.version);
+        ret = -1;
+        break;
+      }
+
+      print_stats(&stats);
+      if (interval_ms > 0) {
+        printf("\n");
+        fflush(stdout);
+        usleep(interval_ms * 1000);
+      }
+    } while (interval_ms > 0);
+  }
+
+  hid_close(dev);
+  hid_exit();
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,451 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// same values as pico-sdk hardware/flash.h, storage.h uses them for layout
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define XIP_BASE 0x10000000
+
+#include "storage.h"
+
+// UF2 block format (https://github.com/microsoft/uf2)
+#define UF2_MAGIC_START0 0x0A324655
+#define UF2_MAGIC_START1 0x9E5D5157
+#define UF2_MAGIC_END 0x0AB16F30
+#define UF2_FLAG_FAMILY_ID 0x00002000
+#define UF2_BLOCK_SIZE 512
+
+#define FAMILY_RP2040 0xe48bff56
+#define FAMILY_RP2350 0xe48bff59 // RP2350 Arm secure
+
+#define KEYSTORE_SIZE FLASH_SECTOR_SIZE
+#define KEYSTORE_BLOCKS (KEYSTORE_SIZE / FLASH_PAGE_SIZE)
+
+typedef struct {
+  uint32_t magic_start0;
+  uint32_t magic_start1;
+  uint32_t flags;
+  uint32_t target_addr;
+  uint32_t payload_size;
+  uint32_t block_no;
+  uint32_t num_blocks;
+  uint32_t family_id;
+  uint8_t data[476];
+  uint32_t magic_end;
+} uf2_block_t;
+
+_Static_assert(sizeof(uf2_block_t) == UF2_BLOCK_SIZE, "bad uf2 block size");
+
+// one device of the manifest, strings point into the mapped manifest
+typedef struct {
+  const char *name;
+  const char *mkey;
+  const char *skey;
+  size_t name_len;
+  size_t mkey_len;
+  size_t skey_len;
+} device_t;
+
+typedef struct {
+  const char *outdir;
+  bool binary;
+  uint32_t family_id;
+
+  // firmware to merge into each image (optional)
+  const uf2_block_t *firmware;
+  size_t firmware_blocks;
+  size_t firmware_family_blocks; // blocks to renumber with the key store
+
+  device_t *devices;
+  size_t device_count;
+
+  atomic_size_t next;
+  atomic_size_t failed;
+} job_t;
+
+// ---------- Manifest ----------
+
+static int compare_names(const void *a, const void *b) {
+  const device_t *x = *(const device_t *const *)a;
+  const device_t *y = *(const device_t *const *)b;
+  size_t len = x->name_len < y->name_len ? x->name_len : y->name_len;
+
+  int cmp = memcmp(x->name, y->name, len);
+  if (cmp != 0)
+    return cmp;
+  return (x->name_len > y->name_len) - (x->name_len < y->name_len);
+}
+
+// Two devices with one name would have workers writing the same file
+static int check_duplicates(const device_t *devices, size_t count) {
+  const device_t **sorted = malloc(count * sizeof(*sorted));
+  if (count && !sorted) {
+    perror("malloc");
+    return -1;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    sorted[i] = &devices[i];
+  qsort(sorted, count, sizeof(*sorted), compare_names);
+
+  int ret = 0;
+  for (size_t i = 1; i < count && ret == 0; i++) {
+    if (compare_names(&sorted[i - 1], &sorted[i]) == 0) {
+      fprintf(stderr, "manifest: duplicate device name %.*s\n",
+              (int)sorted[i]->name_len, sorted[i]->name);
+      ret = -1;
+    }
+  }
+
+  free(sorted);
+  return ret;
+}
+
+// Split next tab separated field of a line, return false past its end
+static bool next_field(const char **p, const char *eol, const char **field,
+                       size_t *len) {
+  if (*p > eol)
+    return false;
+
+  const char *tab = memchr(*p, '\t', eol - *p);
+  const char *stop = tab ? tab : eol;
+
+  *field = *p;
+  *len = stop - *p;
+  *p = stop + 1;
+  return true;
+}
+
+// Parse "<name>\t<mkey>\t<skey>" lines, keys may hold any char but tab.
+// Lines starting with '#' and blank lines are skipped.
+static int parse_manifest(const char *buf, size_t size, device_t **devices,
+                          size_t *count) {
+  size_t cap = 0;
+  const char *p = buf;
+  const char *end = buf + size;
+  int line = 0;
+
+  *devices = NULL;
+  *count = 0;
+
+  while (p < end) {
+    device_t dev = {0};
+    const char *extra;
+    size_t extra_len;
+    line++;
+
+    const char *eol = memchr(p, '\n', end - p);
+    const char *next = eol ? eol + 1 : end;
+    if (!eol)
+      eol = end;
+    if (eol > p && eol[-1] == '\r')
+      eol--;
+
+    if (eol == p || *p == '#') {
+      p = next;
+      continue;
+    }
+
+    if (!next_field(&p, eol, &dev.name, &dev.name_len) ||
+        !next_field(&p, eol, &dev.mkey, &dev.mkey_len) ||
+        !next_field(&p, eol, &dev.skey, &dev.skey_len) ||
+        next_field(&p, eol, &extra, &extra_len) || dev.name_len == 0) {
+      fprintf(stderr,
+              "manifest:%d: expected <name> <mkey> <skey> separated by tabs\n",
+              line);
+      return -1;
+    }
+
+    if (dev.mkey_len >= BLOCK_SIZE || dev.skey_len >= BLOCK_SIZE) {
+      fprintf(stderr, "manifest:%d: key longer than %d chars\n", line,
+              BLOCK_SIZE - 1);
+      return -1;
+    }
+
+    if (memchr(dev.name, '/', dev.name_len) ||
+        memchr(dev.mkey, 0, dev.mkey_len) || memchr(dev.skey, 0, dev.skey_len)) {
+      fprintf(stderr, "manifest:%d: invalid device name or key\n", line);
+      return -1;
+    }
+
+    if (*count == cap) {
+      cap = cap ? cap * 2 : 1024;
+      device_t *grown = realloc(*devices, cap * sizeof(device_t));
+      if (!grown) {
+        perror("realloc");
+        return -1;
+      }
+      *devices = grown;
+    }
+    (*devices)[(*count)++] = dev;
+
+    p = next;
+  }
+
+  return check_duplicates(*devices, *count);
+}
+
+// ---------- Image ----------
+
+// Build the key store sector the way storage.c writes it
+static void build_keystore(const device_t *dev, uint8_t *sector) {
+  memset(sector, 0xFF, KEYSTORE_SIZE);
+
+  uint8_t *mkey = sector + MKEY_BLOCK * BLOCK_SIZE;
+  memset(mkey, 0, BLOCK_SIZE);
+  memcpy(mkey, dev->mkey, dev->mkey_len);
+
+  uint8_t *skey = sector + SKEY_BLOCK * BLOCK_SIZE;
+  memset(skey, 0, BLOCK_SIZE);
+  memcpy(skey, dev->skey, dev->skey_len);
+}
+
+// Write the key store as UF2 blocks, merged after the firmware if any
+static void write_uf2(const job_t *job, const uint8_t *sector,
+                      uf2_block_t *out) {
+  uint32_t num_blocks = job->firmware_family_blocks + KEYSTORE_BLOCKS;
+  uint32_t block_no = 0;
+
+  for (size_t i = 0; i < job->firmware_blocks; i++) {
+    out[i] = job->firmware[i];
+    if (out[i].family_id == job->family_id) {
+      out[i].block_no = block_no++;
+      out[i].num_blocks = num_blocks;
+    }
+  }
+
+  out += job->firmware_blocks;
+  for (uint32_t i = 0; i < KEYSTORE_BLOCKS; i++) {
+    memset(&out[i], 0, sizeof(uf2_block_t));
+    out[i].magic_start0 = UF2_MAGIC_START0;
+    out[i].magic_start1 = UF2_MAGIC_START1;
+    out[i].flags = UF2_FLAG_FAMILY_ID;
+    out[i].target_addr = XIP_BASE + FLASH_TARGET_OFFSET + i * FLASH_PAGE_SIZE;
+    out[i].payload_size = FLASH_PAGE_SIZE;
+    out[i].block_no = block_no++;
+    out[i].num_blocks = num_blocks;
+    out[i].family_id = job->family_id;
+    memcpy(out[i].data, sector + i * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
+    out[i].magic_end = UF2_MAGIC_END;
+  }
+}
+
+// Create one output file through a shared mapping
+static int write_image(const job_t *job, const device_t *dev) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%.*s.%s", job->outdir, (int)dev->name_len,
+           dev->name, job->binary ? "bin" : "uf2");
+
+  size_t size = job->binary
+                    ? KEYSTORE_SIZE
+                    : (job->firmware_blocks + KEYSTORE_BLOCKS) * UF2_BLOCK_SIZE;
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  // reserve the blocks now, a full disk would fault the mapping later
+  int err = posix_fallocate(fd, 0, size);
+  if (err != 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(err));
+    close(fd);
+    return -1;
+  }
+
+  uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  if (job->binary) {
+    build_keystore(dev, map);
+  } else {
+    uint8_t sector[KEYSTORE_SIZE];
+    build_keystore(dev, sector);
+    write_uf2(job, sector, (uf2_block_t *)map);
+  }
+
+  munmap(map, size);
+  return 0;
+}
+
+// Worker: take devices until none are left
+static void *worker(void *arg) {
+  job_t *job = arg;
+  size_t i;
+
+  while ((i = atomic_fetch_add(&job->next, 1)) < job->device_count) {
+    if (write_image(job, &job->devices[i]) != 0)
+      atomic_fetch_add(&job->failed, 1);
+  }
+
+  return NULL;
+}
+
+// ---------- Main ----------
+
+// Map a whole file read-only
+static const void *map_file(const char *path, size_t *size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    fprintf(stderr, "%s: empty or unreadable\n", path);
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  *size = st.st_size;
+  return map;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-f firmware.uf2] [-o outdir] [-F rp2040|rp2350] [-b] "
+          "[-j jobs] manifest\n",
+          prog);
+}
+
+int main(int argc, char **argv) {
+  job_t job = {.outdir = ".", .family_id = FAMILY_RP2350};
+  const char *firmware_path = NULL;
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:o:F:bj:")) != -1) {
+    switch (opt) {
+    case 'f':
+      firmware_path = optarg;
+      break;
+    case 'o':
+      job.outdir = optarg;
+      break;
+    case 'F':
+      if (strcmp(optarg, "rp2040") == 0) {
+        job.family_id = FAMILY_RP2040;
+      } else if (strcmp(optarg, "rp2350") == 0) {
+        job.family_id = FAMILY_RP2350;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'b':
+      job.binary = true;
+      break;
+    case 'j':
+      jobs = atol(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind != argc - 1 || jobs < 1 || (job.binary && firmware_path)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // manifest
+  size_t manifest_size;
+  const char *manifest = map_file(argv[optind], &manifest_size);
+  if (!manifest)
+    return 1;
+  if (parse_manifest(manifest, manifest_size, &job.devices,
+                     &job.device_count) != 0)
+    return 1;
+
+  // firmware, shared read-only by all workers
+  if (firmware_path) {
+    size_t size;
+    job.firmware = map_file(firmware_path, &size);
+    if (!job.firmware)
+      return 1;
+    if (size % UF2_BLOCK_SIZE) {
+      fprintf(stderr, "%s: not a UF2 file\n", firmware_path);
+      return 1;
+    }
+
+    job.firmware_blocks = size / UF2_BLOCK_SIZE;
+    for (size_t i = 0; i < job.firmware_blocks; i++) {
+      const uf2_block_t *b = &job.firmware[i];
+      if (b->magic_start0 != UF2_MAGIC_START0 ||
+          b->magic_start1 != UF2_MAGIC_START1 ||
+          b->magic_end != UF2_MAGIC_END) {
+        fprintf(stderr, "%s: not a UF2 file\n", firmware_path);
+        return 1;
+      }
+      if (b->target_addr < XIP_BASE + FLASH_TARGET_OFFSET + KEYSTORE_SIZE &&
+          b->target_addr + b->payload_size > XIP_BASE + FLASH_TARGET_OFFSET) {
+        fprintf(stderr, "%s: overlaps the key store at 0x%08x\n",
+                firmware_path, b->target_addr);
+        return 1;
+      }
+      if (b->family_id == job.family_id)
+        job.firmware_family_blocks++;
+    }
+
+    // the key store blocks are numbered within the firmware's family
+    if (job.firmware_family_blocks == 0) {
+      fprintf(stderr, "%s: no blocks for the %s family, check -F\n",
+              firmware_path,
+              job.family_id == FAMILY_RP2040 ? "rp2040" : "rp2350");
+      return 1;
+    }
+  }
+
+  // generate images in parallel
+  if ((size_t)jobs > job.device_count)
+    jobs = job.device_count ? job.device_count : 1;
+
+  pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+  if (!threads) {
+    perror("calloc");
+    return 1;
+  }
+
+  long started = 0;
+  for (; started < jobs; started++) {
+    if (pthread_create(&threads[started], NULL, worker, &job) != 0)
+      break;
+  }
+  if (started == 0)
+    worker(&job);
+
+  for (long i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  size_t failed = atomic_load(&job.failed);
+  printf("Wrote %zu of %zu images\n", job.device_count - failed,
+         job.device_count);
+
+  free(threads);
+  free(job.devices);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,6 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+int configure_serial(int fd, int speed);
+
+#endif // SERIAL_H